@@ -0,0 +1,88 @@
+/*
+Copyright (c) 2009, Hideyuki Tanaka
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY <copyright holder> ''AS IS'' AND ANY
+EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <copyright holder> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "cmdline.h"
+
+// Validates command lines of the test.cpp schema read from a file or stdin.
+//   $ ./batch -j 4 -F host,port,type jobs.txt
+
+#include "cmdline_batch.h"
+
+#include <iostream>
+using namespace std;
+
+static void schema(cmdline::parser &a)
+{
+  a.add<string>("host", 'h', "host name", true, "");
+  a.add<int>("port", 'p', "port number", false, 80, cmdline::range(1, 65535));
+  a.add<string>("type", 't', "protocol type", false, "http", cmdline::oneof<string>("http", "https", "ssh", "ftp"));
+  a.add("gzip", '\0', "gzip when transfer");
+}
+
+int main(int argc, char *argv[])
+{
+  cmdline::parser a;
+  a.add<int>("jobs", 'j', "number of worker threads", false, 1, cmdline::range(1, 256));
+  a.add<string>("format", 'f', "output format", false, "jsonl", cmdline::oneof<string>("jsonl", "tsv"));
+  a.add<string>("fields", 'F', "comma separated option names to output", false, "");
+  a.footer("[file]");
+  a.parse_check(argc, argv);
+
+  vector<string> fields;
+  string fs=a.get<string>("fields");
+  for (size_t b=0, e; b<fs.length(); b=e+1){
+    e=fs.find(',', b);
+    if (e==string::npos) e=fs.length();
+    if (e>b) fields.push_back(fs.substr(b, e-b));
+  }
+
+  FILE *in=stdin;
+  if (a.rest().size()>0){
+    in=fopen(a.rest()[0].c_str(), "rb");
+    if (!in){
+      cerr<<"cannot open: "<<a.rest()[0]<<endl;
+      return 1;
+    }
+  }
+
+  cmdline::batch::stats st;
+  try{
+    cmdline::batch b(schema, fields,
+                     a.get<string>("format")=="tsv"?cmdline::batch_tsv:cmdline::batch_jsonl,
+                     a.get<int>("jobs"));
+    st=b.run(in, stdout);
+  }
+  catch(const cmdline::cmdline_error &e){
+    cerr<<e.what()<<endl;
+    return 1;
+  }
+
+  cerr<<st.lines<<" lines, "<<st.ok<<" ok, "<<st.failed<<" failed"<<endl;
+
+  if (in!=stdin) fclose(in);
+  return st.failed==0?0:2;
+}
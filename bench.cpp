@@ -0,0 +1,161 @@
+/*
+Copyright (c) 2009, Hideyuki Tanaka
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY <copyright holder> ''AS IS'' AND ANY
+EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <copyright holder> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "cmdline.h"
+
+// Checks that parse() stays linear on adversarial input, that
+// set_limits() is enforced, and that readers of another value type
+// are still accepted by add().
+//   $ ./bench
+
+#include <cstdio>
+#include <ctime>
+#include <iostream>
+using namespace std;
+
+static void schema(cmdline::parser &a)
+{
+  a.add<string>("host", 'h', "host name", false, "");
+  a.add<int>("port", 'p', "port number", false, 80, cmdline::range(1, 65535));
+  a.add("gzip", 'g', "gzip when transfer");
+  a.add("verbose", 'v', "verbose");
+  for (int i=0; i<300; i++){
+    char name[16];
+    sprintf(name, "opt%d", i);
+    a.add(name);
+  }
+}
+
+static string clusters(size_t n){ return "p -"+string(n, 'g')+"v"; }
+static string undefined_clusters(size_t n){ return "p -"+string(n, 'z'); }
+static string undefined_longs(size_t n){ string s="p"; while (s.size()<n) s+=" --x"; return s; }
+static string escaped_quotes(size_t n){ string s="p \""; while (s.size()<n) s+="\\\""; return s+"\""; }
+static string long_values(size_t n){ return "p --host="+string(n, 'x'); }
+
+static double seconds()
+{
+  return double(clock())/CLOCKS_PER_SEC;
+}
+
+// seconds per parse, the best of a few runs of at least 20ms each
+static double measure(cmdline::parser &a, const string &in)
+{
+  double best=0;
+  for (int run=0; run<3; run++){
+    size_t reps=0;
+    double start=seconds(), t;
+    do{
+      a.parse(in);
+      a.error_full();
+      reps++;
+    } while ((t=seconds()-start)<0.02);
+    if (run==0 || t/reps<best) best=t/reps;
+  }
+  return best;
+}
+
+static int failures=0;
+
+static void check(bool ok, const char *what)
+{
+  if (ok) return;
+  cout<<"FAIL: "<<what<<endl;
+  failures++;
+}
+
+int main()
+{
+  typedef string (*generator)(size_t);
+  const generator gens[]={clusters, undefined_clusters, undefined_longs, escaped_quotes, long_values};
+  const char *names[]={"clusters", "undefined_clusters", "undefined_longs", "escaped_quotes", "long_values"};
+
+  for (size_t g=0; g<sizeof(gens)/sizeof(gens[0]); g++){
+    cmdline::parser a;
+    schema(a);
+    double prev=0;
+    for (size_t n=1<<14; n<=1<<19; n<<=1){
+      string in=gens[g](n);
+      double t=measure(a, in);
+      double ratio=prev>0?t/prev:0;
+      printf("%-20s %8lu bytes %10.3f ms", names[g], (unsigned long)in.size(), t*1e3);
+      if (prev>0) printf("  x%.2f", ratio);
+      printf("\n");
+      // doubling the input should double the time; 3x leaves room for noise
+      if (prev>0 && ratio>3.0){
+        cout<<"FAIL: "<<names[g]<<" is superlinear"<<endl;
+        failures++;
+      }
+      prev=t;
+    }
+  }
+
+  cmdline::parser a;
+  schema(a);
+  cmdline::limits l;
+  l.max_args=4;
+  l.max_arg_length=8;
+  l.max_total_length=20;
+  a.set_limits(l);
+
+  check(!a.parse("p -g -g -g -g") && a.error()=="too many arguments", "max_args");
+  check(a.parse("p -g -g -g "), "max_args with a trailing space");
+  check(!a.parse("p --host=123456789") && a.error()=="argument is too long", "max_arg_length");
+  check(!a.parse("p -gggggg -gggggg -gggggg") && a.error()=="arguments are too long", "max_total_length");
+  check(a.parse("\"p\" \"-g\" \"-v\" \"-g\""), "quotes are not counted");
+
+  const char *v1[]={"p", "--host=12345"};
+  check(!a.parse(2, v1) && a.error()=="argument is too long", "max_arg_length of argv");
+  const char *v2[]={"p", "-g", "-g", "-g", "-g"};
+  check(!a.parse(5, v2) && a.error()=="too many arguments", "max_args of argv");
+  const char *v3[]={"p", "-gggggg", "-gggggg", "-gggggg"};
+  check(!a.parse(4, v3) && a.error()=="arguments are too long", "max_total_length of argv");
+
+  // a failed parse does not keep values of the previous one
+  check(a.parse("p -h a.com x"), "parse");
+  check(!a.parse("p -h \"a.com") && !a.exist("host") && a.rest().empty(), "reset after error");
+
+  // a huge input is rejected without scanning it
+  string huge(1<<26, 'x');
+  double start=seconds();
+  check(!a.parse(huge) && a.error()=="argument is too long", "huge argument");
+  check(seconds()-start<0.01, "huge argument is rejected early");
+
+  // readers convert to the option type, as they did before status readers
+  cmdline::parser m;
+  m.add<unsigned>("port", 'p', "", false, 80, cmdline::range(1, 65535));
+  m.add<long>("level", 'l', "", false, 1, cmdline::range(1, 10));
+  m.add<double>("ratio", 'r', "", false, 1, cmdline::oneof(1, 2));
+  m.add<long>("jobs", 'j', "", false, 1, cmdline::independent(cmdline::range(1, 64)));
+  check(m.parse("p -p 8080 -l 9 -r 2 -j 4") && m.get<unsigned>("port")==8080 &&
+        m.get<long>("level")==9 && m.get<double>("ratio")==2 && m.get<long>("jobs")==4,
+        "readers of another value type");
+  check(!m.parse("p -p 0"), "range of another value type");
+
+  if (failures) return 1;
+  cout<<"ok"<<endl;
+  return 0;
+}
@@ -0,0 +1,49 @@
+/*
+  Copyright (c) 2009, Hideyuki Tanaka
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+  * Redistributions of source code must retain the above copyright
+  notice, this list of conditions and the following disclaimer.
+  * Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+  * Neither the name of the <organization> nor the
+  names of its contributors may be used to endorse or promote products
+  derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY <copyright holder> ''AS IS'' AND ANY
+  EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL <copyright holder> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Compiled part of cmdline for CMDLINE_SEPARATE_COMPILATION builds.
+// Programs which use this must define CMDLINE_SEPARATE_COMPILATION
+// before including cmdline.h.
+
+#define CMDLINE_SEPARATE_COMPILATION
+#define CMDLINE_SOURCE
+#include "cmdline.h"
+
+namespace cmdline{
+
+template class parser::option_with_value<int>;
+template class parser::option_with_value<long>;
+template class parser::option_with_value<double>;
+template class parser::option_with_value<std::string>;
+template class parser::option_with_value<bool>;
+template class parser::option_with_value_with_reader<int, default_reader<int> >;
+template class parser::option_with_value_with_reader<long, default_reader<long> >;
+template class parser::option_with_value_with_reader<double, default_reader<double> >;
+template class parser::option_with_value_with_reader<std::string, default_reader<std::string> >;
+template class parser::option_with_value_with_reader<bool, default_reader<bool> >;
+
+} // cmdline
@@ -27,22 +27,70 @@
 
 #pragma once
 
-#include <iostream>
+// By default cmdline.h is header-only.
+// If CMDLINE_SEPARATE_COMPILATION is defined, the non-template part of
+// the parser is not defined here, and cmdline.cpp must be compiled and
+// linked into the program instead.
+
 #include <sstream>
 #include <vector>
 #include <map>
+#include <list>
 #include <string>
 #include <stdexcept>
 #include <typeinfo>
 #include <cstring>
+#include <cctype>
 #include <algorithm>
-#include <cxxabi.h>
 #include <cstdlib>
+#include <climits>
+
+#if !defined(CMDLINE_SEPARATE_COMPILATION) || defined(CMDLINE_SOURCE)
+#include <iostream>
+#include <cxxabi.h>
+#if __cplusplus>=201103L
+#include <atomic>
+#include <exception>
+#include <thread>
+#endif
+#endif
+
+#ifdef CMDLINE_SEPARATE_COMPILATION
+#define CMDLINE_DECL
+#else
+#define CMDLINE_DECL inline
+#endif
+
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS) || defined(_CPPUNWIND)
+#define CMDLINE_THROW(e) throw e
+#else
+#define CMDLINE_NO_EXCEPTIONS
+#define CMDLINE_THROW(e) cmdline::detail::fatal(e)
+#endif
 
 namespace cmdline{
 
+// result of a reader: readers return one of these instead of throwing
+enum read_result{
+  read_ok=0,
+  read_invalid_format,
+  read_out_of_range,
+  read_not_allowed
+};
+
+enum time_unit{
+  nanoseconds,
+  microseconds,
+  milliseconds,
+  seconds,
+  minutes,
+  hours
+};
+
 namespace detail{
 
+void fatal(const std::exception &e);
+
 template <typename Target, typename Source, bool Same>
 class lexical_cast_t{
 public:
@@ -50,7 +98,7 @@ public:
     Target ret;
     std::stringstream ss;
     if (!(ss<<arg && ss>>ret && ss.eof()))
-      throw std::bad_cast();
+      CMDLINE_THROW(std::bad_cast());
     
     return ret;
   }
@@ -81,7 +129,7 @@ public:
     Target ret;
     std::istringstream ss(arg);
     if (!(ss>>ret && ss.eof()))
-      throw std::bad_cast();
+      CMDLINE_THROW(std::bad_cast());
     return ret;
   }
 };
@@ -102,14 +150,7 @@ Target lexical_cast(const Source &arg)
   return lexical_cast_t<Target, Source, detail::is_same<Target, Source>::value>::cast(arg);
 }
 
-static inline std::string demangle(const std::string &name)
-{
-  int status=0;
-  char *p=abi::__cxa_demangle(name.c_str(), 0, 0, &status);
-  std::string ret(p);
-  free(p);
-  return ret;
-}
+std::string demangle(const std::string &name);
 
 template <class T>
 std::string readable_typename()
@@ -129,6 +170,313 @@ inline std::string readable_typename<std::string>()
   return "string";
 }
 
+// long long is an extension before C++11; keep -pedantic C++98 builds quiet
+#if defined(__GNUC__) && __cplusplus<201103L
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wlong-long"
+#endif
+
+typedef unsigned long long umax_t;
+
+// integer types which are parsed by read_integer
+template <class T>
+struct integer_limits{
+  static const bool checked=false;
+};
+
+template <>
+struct integer_limits<short>{
+  static const bool checked=true;
+  static const short min_value=SHRT_MIN;
+  static const short max_value=SHRT_MAX;
+};
+
+template <>
+struct integer_limits<unsigned short>{
+  static const bool checked=true;
+  static const unsigned short min_value=0;
+  static const unsigned short max_value=USHRT_MAX;
+};
+
+template <>
+struct integer_limits<int>{
+  static const bool checked=true;
+  static const int min_value=INT_MIN;
+  static const int max_value=INT_MAX;
+};
+
+template <>
+struct integer_limits<unsigned int>{
+  static const bool checked=true;
+  static const unsigned int min_value=0;
+  static const unsigned int max_value=UINT_MAX;
+};
+
+template <>
+struct integer_limits<long>{
+  static const bool checked=true;
+  static const long min_value=LONG_MIN;
+  static const long max_value=LONG_MAX;
+};
+
+template <>
+struct integer_limits<unsigned long>{
+  static const bool checked=true;
+  static const unsigned long min_value=0;
+  static const unsigned long max_value=ULONG_MAX;
+};
+
+#if __cplusplus>=201103L || defined(LLONG_MAX)
+template <>
+struct integer_limits<long long>{
+  static const bool checked=true;
+  static const long long min_value=LLONG_MIN;
+  static const long long max_value=LLONG_MAX;
+};
+
+template <>
+struct integer_limits<unsigned long long>{
+  static const bool checked=true;
+  static const unsigned long long min_value=0;
+  static const unsigned long long max_value=ULLONG_MAX;
+};
+#endif
+
+#if defined(__GNUC__) && __cplusplus<201103L
+#pragma GCC diagnostic pop
+#endif
+
+struct unit_suffix{
+  const char *name;
+  umax_t scale;
+};
+
+inline const unit_suffix *size_units()
+{
+  // no long long literals, which C++98 does not have
+  const umax_t g=1000000000;
+  static const unit_suffix units[]={
+    {"k", 1000},
+    {"K", 1000},
+    {"M", 1000000},
+    {"G", g},
+    {"T", g*1000},
+    {"P", g*1000000},
+    {"E", g*g},
+    {"Ki", umax_t(1)<<10},
+    {"Mi", umax_t(1)<<20},
+    {"Gi", umax_t(1)<<30},
+    {"Ti", umax_t(1)<<40},
+    {"Pi", umax_t(1)<<50},
+    {"Ei", umax_t(1)<<60},
+    {0, 0}
+  };
+  return units;
+}
+
+inline const unit_suffix *duration_units()
+{
+  const umax_t s=1000000000;
+  static const unit_suffix units[]={
+    {"ns", 1},
+    {"us", 1000},
+    {"ms", 1000000},
+    {"s", s},
+    {"m", s*60},
+    {"h", s*3600},
+    {0, 0}
+  };
+  return units;
+}
+
+inline umax_t time_unit_scale(time_unit u)
+{
+  // same order as time_unit
+  return duration_units()[u].scale;
+}
+
+template <class T>
+bool is_negative(T v)
+{
+  return v<T(1) && v!=T(0);
+}
+
+// Parses an integer in [low, high] in a single pass.
+// Digits are checked against the bound while they are accumulated,
+// so too large values are rejected without reading them to the end.
+// If units is not NULL, the number may be followed by one of the suffixes,
+// and the value is scaled by suffix/base (base is the unit of the result).
+template <class T>
+read_result read_integer(const std::string &s, T low, T high,
+                         const unit_suffix *units, umax_t base, T &ret)
+{
+  const char *p=s.data(), *end=p+s.length();
+
+  while (p!=end && (*p==' ' || *p=='\t')) p++;
+
+  bool neg=false;
+  if (p!=end && (*p=='+' || *p=='-')){
+    neg=*p=='-';
+    p++;
+  }
+
+  // magnitude of the bound in the direction of the sign
+  umax_t limit;
+  if (neg){
+    if (is_negative(low)) limit=umax_t(-(low+1))+1;
+    else if (low==T(0)) limit=0;
+    else return read_out_of_range;
+  }
+  else{
+    if (is_negative(high)) return read_out_of_range;
+    limit=umax_t(high);
+  }
+
+  umax_t digit_limit=limit;
+  if (base>1)
+    digit_limit=limit>ULLONG_MAX/base?ULLONG_MAX:limit*base;
+
+  const char *digits=p;
+  umax_t mag=0;
+  for (; p!=end && *p>='0' && *p<='9'; p++){
+    unsigned d=*p-'0';
+    if (d>digit_limit || mag>(digit_limit-d)/10) return read_out_of_range;
+    mag=mag*10+d;
+  }
+  if (p==digits) return read_invalid_format;
+
+  umax_t scale=base;
+  if (p!=end){
+    if (!units) return read_invalid_format;
+    std::string suffix(p, end);
+    for (; units->name; units++)
+      if (suffix==units->name) break;
+    if (!units->name) return read_invalid_format;
+    scale=units->scale;
+  }
+
+  if (scale>=base){
+    umax_t f=scale/base;
+    if (mag>limit/f) return read_out_of_range;
+    mag*=f;
+  }
+  else{
+    umax_t f=base/scale;
+    if (mag%f!=0) return read_invalid_format;
+    mag/=f;
+  }
+  if (mag>limit) return read_out_of_range;
+
+  if (neg){
+    ret=mag==0?T(0):T(-T(mag-1)-1);
+    if (ret>high) return read_out_of_range;
+  }
+  else{
+    ret=T(mag);
+    if (ret<low) return read_out_of_range;
+  }
+  return read_ok;
+}
+
+template <class T, bool Checked>
+struct value_reader{
+  static read_result read(const std::string &s, T &ret){
+    std::istringstream ss(s);
+    if (!(ss>>ret && ss.eof())) return read_invalid_format;
+    return read_ok;
+  }
+  static read_result read(const std::string &s, const T &low, const T &high, T &ret){
+    read_result r=read(s, ret);
+    if (r!=read_ok) return r;
+    if (!(ret>=low && ret<=high)) return read_out_of_range;
+    return read_ok;
+  }
+};
+
+template <class T>
+struct value_reader<T, true>{
+  static read_result read(const std::string &s, T &ret){
+    return read_integer<T>(s, integer_limits<T>::min_value, integer_limits<T>::max_value, 0, 1, ret);
+  }
+  static read_result read(const std::string &s, const T &low, const T &high, T &ret){
+    return read_integer<T>(s, low, high, 0, 1, ret);
+  }
+};
+
+template <class T>
+read_result read_value(const std::string &s, T &ret)
+{
+  return value_reader<T, integer_limits<T>::checked>::read(s, ret);
+}
+
+inline read_result read_value(const std::string &s, std::string &ret)
+{
+  ret=s;
+  return read_ok;
+}
+
+inline size_t lowest_bit(unsigned long x)
+{
+#ifdef __GNUC__
+  return __builtin_ctzl(x);
+#else
+  size_t n=0;
+  for (; !(x&1); x>>=1) n++;
+  return n;
+#endif
+}
+
+// option value saved by the parse cache
+class value_base{
+public:
+  virtual ~value_base(){}
+};
+
+template <class T>
+class value_holder : public value_base{
+public:
+  value_holder(const T &value): value(value) {}
+  T value;
+};
+
+// FNV-1a
+inline size_t hash_bytes(const std::string &s)
+{
+  umax_t h=(umax_t(0xcbf29ce4)<<32)|0x84222325;
+  const umax_t prime=(umax_t(1)<<40)|0x1b3;
+  for (size_t i=0; i<s.length(); i++){
+    h^=static_cast<unsigned char>(s[i]);
+    h*=prime;
+  }
+  return static_cast<size_t>(h);
+}
+
+// bitset indexed by option id
+struct bitset{
+  static const size_t word_bits=sizeof(unsigned long)*CHAR_BIT;
+
+  void resize(size_t n){
+    words.resize((n+word_bits-1)/word_bits, 0UL);
+  }
+  void set(size_t i){
+    words[i/word_bits]|=1UL<<(i%word_bits);
+  }
+  bool test(size_t i) const {
+    return (words[i/word_bits]>>(i%word_bits))&1UL;
+  }
+  void clear(){
+    std::fill(words.begin(), words.end(), 0UL);
+  }
+  // true if all bits of mask are set
+  bool contains(const bitset &mask) const {
+    for (size_t i=0; i<words.size(); i++)
+      if (mask.words[i]&~words[i]) return false;
+    return true;
+  }
+
+  std::vector<unsigned long> words;
+};
+
 } // detail
 
 //-----
@@ -142,21 +490,47 @@ private:
   std::string msg;
 };
 
+// Readers are function objects which convert an option value.
+// A reader declares `typedef status_reader_tag reader_category;' and provides
+//   read_result operator()(const std::string &s, T &ret) const;
+// which stores the converted value to ret and returns read_ok on success.
+// Readers without reader_category are the old throwing style
+//   T operator()(const std::string &s);
+// and they are wrapped by throwing_reader_adapter.
+
+struct status_reader_tag{};
+
 template <class T>
 struct default_reader{
-  T operator()(const std::string &str){
-    return detail::lexical_cast<T>(str);
+  typedef status_reader_tag reader_category;
+  typedef T value_type;
+  read_result operator()(const std::string &str, T &ret) const {
+    return detail::read_value(str, ret);
+  }
+#ifndef CMDLINE_NO_EXCEPTIONS
+  T operator()(const std::string &str) const {
+    T ret;
+    if (detail::read_value(str, ret)!=read_ok) throw std::bad_cast();
+    return ret;
   }
+#endif
 };
 
 template <class T>
 struct range_reader{
+  typedef status_reader_tag reader_category;
+  typedef T value_type;
   range_reader(const T &low, const T &high): low(low), high(high) {}
+  read_result operator()(const std::string &s, T &ret) const {
+    return detail::value_reader<T, detail::integer_limits<T>::checked>::read(s, low, high, ret);
+  }
+#ifndef CMDLINE_NO_EXCEPTIONS
   T operator()(const std::string &s) const {
-    T ret=default_reader<T>()(s);
-    if (!(ret>=low && ret<=high)) throw cmdline::cmdline_error("range_error");
+    T ret;
+    if ((*this)(s, ret)!=read_ok) throw cmdline::cmdline_error("range_error");
     return ret;
   }
+#endif
 private:
   T low, high;
 };
@@ -167,19 +541,230 @@ range_reader<T> range(const T &low, const T &high)
   return range_reader<T>(low, high);
 }
 
+// Integer reader with bounds given as template arguments:
+//   cmdline::bounded_reader<int, 1, 65535>()
+template <class T,
+          T Low=detail::integer_limits<T>::min_value,
+          T High=detail::integer_limits<T>::max_value>
+struct bounded_reader{
+  typedef status_reader_tag reader_category;
+  typedef T value_type;
+  typedef char low_must_not_exceed_high[Low<=High?1:-1];
+  read_result operator()(const std::string &s, T &ret) const {
+    return detail::read_integer<T>(s, Low, High, 0, 1, ret);
+  }
+};
+
+// Integer reader which accepts size suffixes:
+// k, M, G, T, P, E (powers of 1000) and Ki, Mi, Gi, Ti, Pi, Ei (powers of 1024).
+// "64Mi" is read as 67108864.
+template <class T,
+          T Low=detail::integer_limits<T>::min_value,
+          T High=detail::integer_limits<T>::max_value>
+struct size_reader{
+  typedef status_reader_tag reader_category;
+  typedef T value_type;
+  typedef char low_must_not_exceed_high[Low<=High?1:-1];
+  read_result operator()(const std::string &s, T &ret) const {
+    return detail::read_integer<T>(s, Low, High, detail::size_units(), 1, ret);
+  }
+};
+
+// Integer reader which accepts duration suffixes: ns, us, ms, s, m, h.
+// The value is converted to Unit, and a number without suffix is in Unit.
+// "250ms" is read as 250 for milliseconds, and rejected for seconds.
+template <class T,
+          time_unit Unit=milliseconds,
+          T Low=detail::integer_limits<T>::min_value,
+          T High=detail::integer_limits<T>::max_value>
+struct duration_reader{
+  typedef status_reader_tag reader_category;
+  typedef T value_type;
+  typedef char low_must_not_exceed_high[Low<=High?1:-1];
+  read_result operator()(const std::string &s, T &ret) const {
+    return detail::read_integer<T>(s, Low, High, detail::duration_units(),
+                                   detail::time_unit_scale(Unit), ret);
+  }
+};
+
 template <class T>
 struct oneof_reader{
-  T operator()(const std::string &s){
-    T ret=default_reader<T>()(s);
+  typedef status_reader_tag reader_category;
+  typedef T value_type;
+  read_result operator()(const std::string &s, T &ret) const {
+    read_result r=default_reader<T>()(s, ret);
+    if (r!=read_ok) return r;
     if (std::find(alt.begin(), alt.end(), ret)==alt.end())
-      throw cmdline_error("");
+      return read_not_allowed;
+    return read_ok;
+  }
+#ifndef CMDLINE_NO_EXCEPTIONS
+  T operator()(const std::string &s) const {
+    T ret;
+    if ((*this)(s, ret)!=read_ok) throw cmdline_error("");
     return ret;
   }
+#endif
   void add(const T &v){ alt.push_back(v); }
+  const std::vector<T> &alternatives() const { return alt; }
 private:
   std::vector<T> alt;
 };
 
+template <class T, class F>
+struct throwing_reader_adapter{
+  typedef status_reader_tag reader_category;
+  throwing_reader_adapter(F reader): reader(reader) {}
+  read_result operator()(const std::string &s, T &ret) const {
+#ifndef CMDLINE_NO_EXCEPTIONS
+    try{
+      ret=reader(s);
+    }
+    catch(const std::exception &){
+      return read_invalid_format;
+    }
+#else
+    ret=reader(s);
+#endif
+    return read_ok;
+  }
+private:
+  mutable F reader;
+};
+
+// Reads with a status reader of another value type and assigns the result,
+// e.g. add<unsigned>(..., range(1, 65535)) reads an int.
+template <class T, class F>
+struct converting_reader_adapter{
+  typedef status_reader_tag reader_category;
+  converting_reader_adapter(F reader): reader(reader) {}
+  read_result operator()(const std::string &s, T &ret) const {
+    typename F::value_type v;
+    read_result r=reader(s, v);
+    if (r==read_ok) ret=v;
+    return r;
+  }
+  F reader;
+};
+
+// Marks a reader as independent of other readers and safe to call from
+// several threads. With parser::set_concurrency(), such readers run in
+// parallel during parse():
+//   a.add<string>("input", 'i', "input file", true, "", cmdline::independent(file_reader()));
+template <class F>
+struct independent_reader{
+  independent_reader(F reader): reader(reader) {}
+  template <class T>
+  read_result operator()(const std::string &s, T &ret) const {
+    return reader(s, ret);
+  }
+  F reader;
+};
+
+template <class F>
+independent_reader<F> independent(F reader)
+{
+  return independent_reader<F>(reader);
+}
+
+namespace detail{
+
+template <class F>
+struct is_status_reader{
+  typedef char yes;
+  typedef char (&no)[2];
+  template <class U> static yes test(typename U::reader_category *);
+  template <class U> static no test(...);
+  static const bool value=sizeof(test<F>(0))==sizeof(yes);
+};
+
+template <class F>
+struct has_value_type{
+  typedef char yes;
+  typedef char (&no)[2];
+  template <class U> static yes test(typename U::value_type *);
+  template <class U> static no test(...);
+  static const bool value=sizeof(test<F>(0))==sizeof(yes);
+};
+
+// value type of a status reader; readers without value_type read T
+template <class T, class F, bool Has=has_value_type<F>::value>
+struct reader_value_type{
+  typedef T type;
+};
+
+template <class T, class F>
+struct reader_value_type<T, F, true>{
+  typedef typename F::value_type type;
+};
+
+template <class T, class F, class V>
+struct status_reader_traits{
+  typedef converting_reader_adapter<T, F> type;
+  static type wrap(F reader){ return type(reader); }
+};
+
+template <class T, class F>
+struct status_reader_traits<T, F, T>{
+  typedef F type;
+  static type wrap(F reader){ return reader; }
+};
+
+template <class T, class F, bool Status>
+struct reader_traits
+  : status_reader_traits<T, F, typename reader_value_type<T, F>::type>{
+};
+
+template <class T, class F>
+struct reader_traits<T, F, false>{
+  typedef throwing_reader_adapter<T, F> type;
+  static type wrap(F reader){ return type(reader); }
+};
+
+template <class T, class F>
+struct reader_traits<T, independent_reader<F>, false>{
+  typedef reader_traits<T, F, is_status_reader<F>::value> inner;
+  typedef independent_reader<typename inner::type> type;
+  static type wrap(independent_reader<F> r){ return type(inner::wrap(r.reader)); }
+};
+
+template <class F>
+struct is_independent{
+  static const bool value=false;
+};
+
+template <class F>
+struct is_independent<independent_reader<F> >{
+  static const bool value=true;
+};
+
+// values accepted by a reader, used for shell completion
+template <class F>
+void reader_alternatives(const F &, std::vector<std::string> &)
+{
+}
+
+template <class T>
+void reader_alternatives(const oneof_reader<T> &reader, std::vector<std::string> &ret)
+{
+  for (size_t i=0; i<reader.alternatives().size(); i++)
+    ret.push_back(default_value<T>(reader.alternatives()[i]));
+}
+
+template <class F>
+void reader_alternatives(const independent_reader<F> &reader, std::vector<std::string> &ret)
+{
+  reader_alternatives(reader.reader, ret);
+}
+
+template <class T, class F>
+void reader_alternatives(const converting_reader_adapter<T, F> &reader, std::vector<std::string> &ret)
+{
+  reader_alternatives(reader.reader, ret);
+}
+
+} // detail
+
 template <class T>
 oneof_reader<T> oneof(T a1)
 {
@@ -305,25 +890,25 @@ oneof_reader<T> oneof(T a1, T a2, T a3, T a4, T a5, T a6, T a7, T a8, T a9, T a1
   return ret;
 }
 
+// Hard limits of the input of parse(). 0 means no limit.
+struct limits{
+  limits(): max_args(0), max_arg_length(0), max_total_length(0) {}
+  size_t max_args;          // argc, including the program name
+  size_t max_arg_length;    // length of one argument
+  size_t max_total_length;  // sum of the lengths of all arguments
+};
+
 //-----
 
 class parser{
 public:
-  parser(){
-  }
-  ~parser(){
-    for (std::map<std::string, option_base*>::iterator p=options.begin();
-         p!=options.end(); p++)
-      delete p->second;
+  parser(): short_ids(256, no_option), concurrency(0), cache_capacity(0), hits(0), misses(0){
   }
+  ~parser();
 
   void add(const std::string &name,
            char short_name=0,
-           const std::string &desc=""){
-    if (options.count(name)) throw cmdline_error("multiple definition: "+name);
-    options[name]=new option_without_value(name, short_name, desc);
-    ordered.push_back(options[name]);
-  }
+           const std::string &desc="");
 
   template <class T>
   void add(const std::string &name,
@@ -341,9 +926,100 @@ public:
            bool need=true,
            const T def=T(),
            F reader=F()){
-    if (options.count(name)) throw cmdline_error("multiple definition: "+name);
-    options[name]=new option_with_value_with_reader<T, F>(name, short_name, need, def, desc, reader);
-    ordered.push_back(options[name]);
+    if (index.count(name)) CMDLINE_THROW(cmdline_error("multiple definition: "+name));
+    typedef detail::reader_traits<T, F, detail::is_status_reader<F>::value> traits;
+    register_option(name, short_name, need, full_description(desc, need, def),
+                    new option_with_value_with_reader<T, typename traits::type>(def, traits::wrap(reader), NULL));
+  }
+
+  // Binds an option to an existing variable.
+  // The value is written to var directly while parsing,
+  // and the initial value of var is used as the default value.
+  template <class T>
+  void add(const std::string &name,
+           T &var,
+           char short_name=0,
+           const std::string &desc="",
+           bool need=true){
+    add(name, var, short_name, desc, need, default_reader<T>());
+  }
+
+  template <class T, class F>
+  void add(const std::string &name,
+           T &var,
+           char short_name,
+           const std::string &desc,
+           bool need,
+           F reader){
+    if (index.count(name)) CMDLINE_THROW(cmdline_error("multiple definition: "+name));
+    typedef detail::reader_traits<T, F, detail::is_status_reader<F>::value> traits;
+    register_option(name, short_name, need, full_description(desc, need, var),
+                    new option_with_value_with_reader<T, typename traits::type>(var, traits::wrap(reader), &var));
+  }
+
+  // Binds options to members of obj:
+  //   a.bind(cfg)
+  //     .add("host", &config::host, 'h', "host name")
+  //     .add("port", &config::port, 'p', "port number", false, cmdline::range(1, 65535));
+  template <class C>
+  class binder{
+  public:
+    binder(parser &p, C &obj): p(p), obj(obj) {}
+
+    template <class T>
+    binder &add(const std::string &name,
+                T C::*member,
+                char short_name=0,
+                const std::string &desc="",
+                bool need=true){
+      p.add(name, obj.*member, short_name, desc, need);
+      return *this;
+    }
+
+    template <class T, class F>
+    binder &add(const std::string &name,
+                T C::*member,
+                char short_name,
+                const std::string &desc,
+                bool need,
+                F reader){
+      p.add(name, obj.*member, short_name, desc, need, reader);
+      return *this;
+    }
+
+  private:
+    parser &p;
+    C &obj;
+  };
+
+  template <class C>
+  binder<C> bind(C &obj){
+    return binder<C>(*this, obj);
+  }
+
+  // Caches the results of parse() for the last capacity distinct
+  // argument vectors. A repeated argument vector restores the values,
+  // positional arguments and errors without reading the arguments again.
+  // add() clears the cache. capacity 0 disables it.
+  void enable_cache(size_t capacity);
+
+  size_t cache_hits() const {
+    return hits;
+  }
+
+  size_t cache_misses() const {
+    return misses;
+  }
+
+  void set_limits(const limits &l){
+    lim=l;
+  }
+
+  // Runs readers marked by independent() on up to threads threads
+  // during parse(). Values and errors are the same as the serial parse.
+  // Without C++11, they are run one by one after the arguments are read.
+  void set_concurrency(size_t threads){
+    concurrency=threads;
   }
 
   void footer(const std::string &f){
@@ -354,271 +1030,106 @@ public:
     prog_name=name;
   }
 
-  bool exist(const std::string &name) const {
-    if (options.count(name)==0) throw cmdline_error("there is no flag: --"+name);
-    return options.find(name)->second->has_set();
-  }
+  bool exist(const std::string &name) const;
 
   template <class T>
   const T &get(const std::string &name) const {
-    if (options.count(name)==0) throw cmdline_error("there is no flag: --"+name);
-    const option_with_value<T> *p=dynamic_cast<const option_with_value<T>*>(options.find(name)->second);
-    if (p==NULL) throw cmdline_error("type mismatch flag '"+name+"'");
+    size_t id;
+    if (!find(name, id)) CMDLINE_THROW(cmdline_error("there is no flag: --"+name));
+    const option_with_value<T> *p=dynamic_cast<const option_with_value<T>*>(ordered[id]);
+    if (p==NULL) CMDLINE_THROW(cmdline_error("type mismatch flag '"+name+"'"));
     return p->get();
   }
 
+  // value of the option converted to a string ("true"/"false" for flags)
+  std::string value_string(const std::string &name) const;
+
   const std::vector<std::string> &rest() const {
     return others;
   }
 
-  bool parse(const std::string &arg){
-    std::vector<std::string> args;
+  // parse() runs in time and memory linear in the total length of the
+  // arguments, for any input. set_limits() bounds that length.
+  bool parse(const std::string &arg);
 
-    std::string buf;
-    bool in_quote=false;
-    for (std::string::size_type i=0; i<arg.length(); i++){
-      if (arg[i]=='\"'){
-        in_quote=!in_quote;
-        continue;
-      }
+  bool parse(const std::vector<std::string> &args);
 
-      if (arg[i]==' ' && !in_quote){
-        args.push_back(buf);
-        buf="";
-        continue;
-      }
+  bool parse(int argc, const char * const argv[]);
 
-      if (arg[i]=='\\'){
-        i++;
-        if (i>=arg.length()){
-          errors.push_back("unexpected occurrence of '\\' at end of string");
-          return false;
-        }
-      }
+  void parse_check(const std::string &arg);
 
-      buf+=arg[i];
-    }
+  void parse_check(const std::vector<std::string> &args);
 
-    if (in_quote){
-      errors.push_back("quote is not closed");
-      return false;
-    }
+  void parse_check(int argc, char *argv[]);
 
-    if (buf.length()>0)
-      args.push_back(buf);
+  std::string error() const{
+    return errors.size()>0?errors[0]:"";
+  }
 
-    for (size_t i=0; i<args.size(); i++)
-      std::cout<<"\""<<args[i]<<"\""<<std::endl;
+  std::string error_full() const;
 
-    return parse(args);
-  }
+  std::string usage() const;
 
-  bool parse(const std::vector<std::string> &args){
-    int argc=static_cast<int>(args.size());
-    std::vector<const char*> argv(argc);
+  // Shell completion script for "bash", "zsh" or "fish".
+  // It can be generated once at build time and installed with the program.
+  std::string completion(const std::string &shell) const;
 
-    for (int i=0; i<argc; i++)
-      argv[i]=args[i].c_str();
+private:
 
-    return parse(argc, &argv[0]);
-  }
+  class option_base;
 
-  bool parse(int argc, const char * const argv[]){
-    errors.clear();
-    others.clear();
+  enum{
+    no_option=-1,
+    ambiguous_option=-2
+  };
 
-    if (argc<1){
-      errors.push_back("argument number must be longer than 0");
-      return false;
-    }
-    if (prog_name=="")
-      prog_name=argv[0];
+  void check(int argc, bool ok);
 
-    std::map<char, std::string> lookup;
-    for (std::map<std::string, option_base*>::iterator p=options.begin();
-         p!=options.end(); p++){
-      if (p->first.length()==0) continue;
-      char initial=p->second->short_name();
-      if (initial){
-        if (lookup.count(initial)>0){
-          lookup[initial]="";
-          errors.push_back(std::string("short option '")+initial+"' is ambiguous");
-          return false;
-        }
-        else lookup[initial]=p->first;
-      }
-    }
+  bool parse_args(int argc, const char * const argv[]);
 
-    for (int i=1; i<argc; i++){
-      if (strncmp(argv[i], "--", 2)==0){
-        const char *p=strchr(argv[i]+2, '=');
-        if (p){
-          std::string name(argv[i]+2, p);
-          std::string val(p+1);
-          set_option(name, val);
-        }
-        else{
-          std::string name(argv[i]+2);
-          if (options.count(name)==0){
-            errors.push_back("undefined option: --"+name);
-            continue;
-          }
-          if (options[name]->has_value()){
-            if (i+1>=argc){
-              errors.push_back("option needs value: --"+name);
-              continue;
-            }
-            else{
-              i++;
-              set_option(name, argv[i]);
-            }
-          }
-          else{
-            set_option(name);
-          }
-        }
-      }
-      else if (strncmp(argv[i], "-", 1)==0){
-        if (!argv[i][1]) continue;
-        char last=argv[i][1];
-        for (int j=2; argv[i][j]; j++){
-          last=argv[i][j];
-          if (lookup.count(argv[i][j-1])==0){
-            errors.push_back(std::string("undefined short option: -")+argv[i][j-1]);
-            continue;
-          }
-          if (lookup[argv[i][j-1]]==""){
-            errors.push_back(std::string("ambiguous short option: -")+argv[i][j-1]);
-            continue;
-          }
-          set_option(lookup[argv[i][j-1]]);
-        }
+  bool check_limits(int argc, const char * const argv[]);
 
-        if (lookup.count(last)==0){
-          errors.push_back(std::string("undefined short option: -")+last);
-          continue;
-        }
-        if (lookup[last]==""){
-          errors.push_back(std::string("ambiguous short option: -")+last);
-          continue;
-        }
+  // clears the state of the previous parse and records err
+  bool parse_failed(const std::string &err);
 
-        if (i+1<argc && options[lookup[last]]->has_value()){
-          set_option(lookup[last], argv[i+1]);
-          i++;
-        }
-        else{
-          set_option(lookup[last]);
-        }
-      }
-      else{
-        others.push_back(argv[i]);
-      }
-    }
+  void reset_options();
 
-    for (std::map<std::string, option_base*>::iterator p=options.begin();
-         p!=options.end(); p++)
-      if (!p->second->valid())
-        errors.push_back("need option: --"+std::string(p->first));
-
-    return errors.size()==0;
+  bool find(const std::string &name, size_t &id) const {
+    std::map<std::string, size_t>::const_iterator p=index.find(name);
+    if (p==index.end()) return false;
+    id=p->second;
+    return true;
   }
 
-  void parse_check(const std::string &arg){
-    if (!options.count("help"))
-      add("help", '?', "print this message");
-    check(0, parse(arg));
-  }
+  // desc is the description shown by usage()
+  void register_option(const std::string &name, char short_name, bool need,
+                       const std::string &desc, option_base *opt);
 
-  void parse_check(const std::vector<std::string> &args){
-    if (!options.count("help"))
-      add("help", '?', "print this message");
-    check(args.size(), parse(args));
+  template <class T>
+  static std::string full_description(const std::string &desc, bool need, const T &def){
+    return
+      desc+" ("+detail::readable_typename<T>()+
+      (need?"":" [="+detail::default_value<T>(def)+"]")
+      +")";
   }
 
-  void parse_check(int argc, char *argv[]){
-    if (!options.count("help"))
-      add("help", '?', "print this message");
-    check(argc, parse(argc, argv));
-  }
+  void set_option(size_t id);
 
-  std::string error() const{
-    return errors.size()>0?errors[0]:"";
-  }
+  void set_option(size_t id, const std::string &value);
 
-  std::string error_full() const{
-    std::ostringstream oss;
-    for (size_t i=0; i<errors.size(); i++)
-      oss<<errors[i]<<std::endl;
-    return oss.str();
-  }
+  void run_deferred();
 
-  std::string usage() const {
-    std::ostringstream oss;
-    oss<<"usage: "<<prog_name<<" ";
-    for (size_t i=0; i<ordered.size(); i++){
-      if (ordered[i]->must())
-        oss<<ordered[i]->short_description()<<" ";
-    }
-    
-    oss<<"[options] ... "<<ftr<<std::endl;
-    oss<<"options:"<<std::endl;
+  void discard_deferred();
 
-    size_t max_width=0;
-    for (size_t i=0; i<ordered.size(); i++){
-      max_width=std::max(max_width, ordered[i]->name().length());
-    }
-    for (size_t i=0; i<ordered.size(); i++){
-      if (ordered[i]->short_name()){
-        oss<<"  -"<<ordered[i]->short_name()<<", ";
-      }
-      else{
-        oss<<"      ";
-      }
+  struct cache_entry;
 
-      oss<<"--"<<ordered[i]->name();
-      for (size_t j=ordered[i]->name().length(); j<max_width+4; j++)
-        oss<<' ';
-      oss<<ordered[i]->description()<<std::endl;
-    }
-    return oss.str();
-  }
-
-private:
-
-  void check(int argc, bool ok){
-    if ((argc==1 && !ok) || exist("help")){
-      std::cerr<<usage();
-      exit(0);
-    }
+  void cache_store(const std::string &key, size_t hash, bool ok);
 
-    if (!ok){
-      std::cerr<<error()<<std::endl<<usage();
-      exit(1);
-    }
-  }
+  void cache_restore(const cache_entry &e);
 
-  void set_option(const std::string &name){
-    if (options.count(name)==0){
-      errors.push_back("undefined option: --"+name);
-      return;
-    }
-    if (!options[name]->set()){
-      errors.push_back("option needs value: --"+name);
-      return;
-    }
-  }
+  void cache_evict(std::list<cache_entry>::iterator p);
 
-  void set_option(const std::string &name, const std::string &value){
-    if (options.count(name)==0){
-      errors.push_back("undefined option: --"+name);
-      return;
-    }
-    if (!options[name]->set(value)){
-      errors.push_back("option value is invalid: --"+name+"="+value);
-      return;
-    }
-  }
+  void clear_cache();
 
   class option_base{
   public:
@@ -627,29 +1138,26 @@ private:
     virtual bool has_value() const=0;
     virtual bool set()=0;
     virtual bool set(const std::string &value)=0;
-    virtual bool has_set() const=0;
-    virtual bool valid() const=0;
-    virtual bool must() const=0;
-
-    virtual const std::string &name() const=0;
-    virtual char short_name() const=0;
-    virtual const std::string &description() const=0;
-    virtual std::string short_description() const=0;
+    virtual void reset()=0;
+    virtual std::string value_string() const=0;
+    virtual detail::value_base *save() const=0;
+    virtual std::vector<std::string> alternatives() const=0;
+    virtual bool concurrent() const=0;
+    virtual detail::value_base *convert(const std::string &value)=0;
+    virtual void restore(const detail::value_base *v)=0;
+
+    // shown by usage() for required options
+    virtual std::string short_description(const std::string &name) const=0;
   };
 
   class option_without_value : public option_base {
   public:
-    option_without_value(const std::string &name,
-                         char short_name,
-                         const std::string &desc)
-      :nam(name), snam(short_name), desc(desc), has(false){
-    }
+    option_without_value(){}
     ~option_without_value(){}
 
     bool has_value() const { return false; }
 
     bool set(){
-      has=true;
       return true;
     }
 
@@ -657,57 +1165,49 @@ private:
       return false;
     }
 
-    bool has_set() const {
-      return has;
+    void reset(){
     }
 
-    bool valid() const{
-      return true;
+    std::string value_string() const{
+      return "";
     }
 
-    bool must() const{
-      return false;
+    detail::value_base *save() const{
+      return NULL;
     }
 
-    const std::string &name() const{
-      return nam;
+    std::vector<std::string> alternatives() const{
+      return std::vector<std::string>();
     }
 
-    char short_name() const{
-      return snam;
+    bool concurrent() const{
+      return false;
     }
 
-    const std::string &description() const {
-      return desc;
+    detail::value_base *convert(const std::string &){
+      return NULL;
     }
 
-    std::string short_description() const{
-      return "--"+nam;
+    void restore(const detail::value_base *){
     }
 
-  private:
-    std::string nam;
-    char snam;
-    std::string desc;
-    bool has;
+    std::string short_description(const std::string &name) const{
+      return "--"+name;
+    }
   };
 
   template <class T>
   class option_with_value : public option_base {
   public:
-    option_with_value(const std::string &name,
-                      char short_name,
-                      bool need,
-                      const T &def,
-                      const std::string &desc)
-      : nam(name), snam(short_name), need(need), has(false)
-      , def(def), actual(def) {
-      this->desc=full_description(desc);
+    option_with_value(const T &def, T *dst)
+      : def(def), owned(!dst), dst(dst?dst:new T(def)) {
+    }
+    ~option_with_value(){
+      if (owned) delete dst;
     }
-    ~option_with_value(){}
 
     const T &get() const {
-      return actual;
+      return *dst;
     }
 
     bool has_value() const { return true; }
@@ -716,94 +1216,878 @@ private:
       return false;
     }
 
+    // read into a temporary, so a bound variable keeps its value
+    // when the reader fails after writing to it
     bool set(const std::string &value){
-      try{
-        actual=read(value);
-        has=true;
-      }
-      catch(const std::exception &e){
-        return false;
-      }
+      T v;
+      if (read(value, v)!=read_ok) return false;
+      *dst=v;
       return true;
     }
 
-    bool has_set() const{
-      return has;
-    }
-
-    bool valid() const{
-      if (need && !has) return false;
-      return true;
+    void reset(){
+      *dst=def;
     }
 
-    bool must() const{
-      return need;
+    std::string value_string() const{
+      return detail::default_value<T>(*dst);
     }
 
-    const std::string &name() const{
-      return nam;
+    detail::value_base *save() const{
+      return new detail::value_holder<T>(*dst);
     }
 
-    char short_name() const{
-      return snam;
+    // converts without storing the value; NULL if invalid
+    detail::value_base *convert(const std::string &value){
+      T v;
+      if (read(value, v)!=read_ok) return NULL;
+      return new detail::value_holder<T>(v);
     }
 
-    const std::string &description() const {
-      return desc;
+    void restore(const detail::value_base *v){
+      *dst=static_cast<const detail::value_holder<T>*>(v)->value;
     }
 
-    std::string short_description() const{
-      return "--"+nam+"="+detail::readable_typename<T>();
+    std::string short_description(const std::string &name) const{
+      return "--"+name+"="+detail::readable_typename<T>();
     }
 
   protected:
-    std::string full_description(const std::string &desc){
-      return
-        desc+" ("+detail::readable_typename<T>()+
-        (need?"":" [="+detail::default_value<T>(def)+"]")
-        +")";
-    }
+    virtual read_result read(const std::string &s, T &ret)=0;
 
-    virtual T read(const std::string &s)=0;
+    option_with_value(const option_with_value &);
+    option_with_value &operator=(const option_with_value &);
 
-    std::string nam;
-    char snam;
-    bool need;
-    std::string desc;
-
-    bool has;
     T def;
-    T actual;
+    // the value is stored in *dst: the bound variable, or owned storage
+    bool owned;
+    T *dst;
   };
 
   template <class T, class F>
   class option_with_value_with_reader : public option_with_value<T> {
   public:
-    option_with_value_with_reader(const std::string &name,
-                                  char short_name,
-                                  bool need,
-                                  const T def,
-                                  const std::string &desc,
-                                  F reader)
-      : option_with_value<T>(name, short_name, need, def, desc), reader(reader){
+    option_with_value_with_reader(const T def, F reader, T *dst)
+      : option_with_value<T>(def, dst), reader(reader){
+    }
+
+    std::vector<std::string> alternatives() const{
+      std::vector<std::string> ret;
+      detail::reader_alternatives(reader, ret);
+      return ret;
+    }
+
+    bool concurrent() const{
+      return detail::is_independent<F>::value;
     }
 
   private:
-    T read(const std::string &s){
-      return reader(s);
+    read_result read(const std::string &s, T &ret){
+      return reader(s, ret);
     }
 
     F reader;
   };
 
-  std::map<std::string, option_base*> options;
+  // options are indexed by id, which is the order of definition
+  std::map<std::string, size_t> index;
   std::vector<option_base*> ordered;
+  std::vector<std::string> names;
+  std::vector<char> short_names;
+  std::vector<std::string> descriptions;
+  std::vector<bool> takes_value;
+  std::vector<bool> concurrent;
+  detail::bitset set_bits;
+  detail::bitset required_bits;
+  std::vector<int> short_ids;
+  std::string ambiguous;
   std::string ftr;
 
   std::string prog_name;
   std::vector<std::string> others;
+  limits lim;
+
+  // reads of independent readers postponed to run_deferred()
+  struct deferred_read{
+    size_t id;
+    std::string value;
+    size_t error_pos;
+    detail::value_base *result;
+  };
+  std::vector<deferred_read> deferred;
+  size_t concurrency;
 
   std::vector<std::string> errors;
+
+  // key is the bytes of argv, each terminated by '\0'
+  struct cache_entry{
+    cache_entry(): hash(0), ok(false) {}
+    ~cache_entry(){
+      for (size_t i=0; i<values.size(); i++)
+        delete values[i].second;
+    }
+
+    std::string key;
+    size_t hash;
+    bool ok;
+    detail::bitset set_bits;
+    std::vector<std::pair<size_t, detail::value_base*> > values;
+    std::vector<std::string> others;
+    std::vector<std::string> errors;
+  };
+
+  // most recently used first
+  std::list<cache_entry> cache;
+  std::map<size_t, std::list<cache_entry>::iterator> cache_index;
+  size_t cache_capacity;
+  size_t hits, misses;
 };
 
+#if defined(CMDLINE_SEPARATE_COMPILATION) && !defined(CMDLINE_SOURCE) && __cplusplus>=201103L
+// instantiated in cmdline.cpp
+extern template class parser::option_with_value<int>;
+extern template class parser::option_with_value<long>;
+extern template class parser::option_with_value<double>;
+extern template class parser::option_with_value<std::string>;
+extern template class parser::option_with_value<bool>;
+extern template class parser::option_with_value_with_reader<int, default_reader<int> >;
+extern template class parser::option_with_value_with_reader<long, default_reader<long> >;
+extern template class parser::option_with_value_with_reader<double, default_reader<double> >;
+extern template class parser::option_with_value_with_reader<std::string, default_reader<std::string> >;
+extern template class parser::option_with_value_with_reader<bool, default_reader<bool> >;
+#endif
+
+//-----
+
+#if !defined(CMDLINE_SEPARATE_COMPILATION) || defined(CMDLINE_SOURCE)
+
+namespace detail{
+
+CMDLINE_DECL void fatal(const std::exception &e)
+{
+  std::cerr<<e.what()<<std::endl;
+  abort();
+}
+
+CMDLINE_DECL std::string demangle(const std::string &name)
+{
+  int status=0;
+  char *p=abi::__cxa_demangle(name.c_str(), 0, 0, &status);
+  std::string ret(p);
+  free(p);
+  return ret;
+}
+
+// single-quoted word for sh
+CMDLINE_DECL std::string shell_quote(const std::string &s)
+{
+  std::string ret="'";
+  for (size_t i=0; i<s.length(); i++){
+    if (s[i]=='\'') ret+="'\\''";
+    else ret+=s[i];
+  }
+  return ret+"'";
+}
+
+// backslash before every character which is special for sh
+CMDLINE_DECL std::string shell_escape(const std::string &s)
+{
+  std::string ret;
+  for (size_t i=0; i<s.length(); i++){
+    if (!isalnum(static_cast<unsigned char>(s[i])) && !strchr("-_./=+,@%", s[i]))
+      ret+='\\';
+    ret+=s[i];
+  }
+  return ret;
+}
+
+// text in an _arguments spec
+CMDLINE_DECL std::string zsh_escape(const std::string &s)
+{
+  std::string ret;
+  for (size_t i=0; i<s.length(); i++){
+    if (strchr("[]:\\", s[i])) ret+='\\';
+    ret+=s[i];
+  }
+  return ret;
+}
+
+CMDLINE_DECL std::string fish_quote(const std::string &s)
+{
+  std::string ret="'";
+  for (size_t i=0; i<s.length(); i++){
+    if (s[i]=='\'' || s[i]=='\\') ret+='\\';
+    ret+=s[i];
+  }
+  return ret+"'";
+}
+
+} // detail
+
+CMDLINE_DECL parser::~parser()
+{
+  clear_cache();
+  for (size_t i=0; i<ordered.size(); i++)
+    delete ordered[i];
+}
+
+CMDLINE_DECL void parser::add(const std::string &name,
+                              char short_name,
+                              const std::string &desc)
+{
+  if (index.count(name)) CMDLINE_THROW(cmdline_error("multiple definition: "+name));
+  register_option(name, short_name, false, desc, new option_without_value());
+}
+
+CMDLINE_DECL bool parser::exist(const std::string &name) const
+{
+  size_t id;
+  if (!find(name, id)) CMDLINE_THROW(cmdline_error("there is no flag: --"+name));
+  return set_bits.test(id);
+}
+
+CMDLINE_DECL std::string parser::value_string(const std::string &name) const
+{
+  size_t id;
+  if (!find(name, id)) CMDLINE_THROW(cmdline_error("there is no flag: --"+name));
+  if (!takes_value[id]) return set_bits.test(id)?"true":"false";
+  return ordered[id]->value_string();
+}
+
+CMDLINE_DECL bool parser::parse(const std::string &arg)
+{
+  std::vector<std::string> args;
+  errors.clear();
+
+  // limits count tokens and their bytes, like check_limits() does for argv
+  size_t total=0;
+  std::string buf;
+  bool in_quote=false;
+  for (std::string::size_type i=0; i<arg.length(); i++){
+    if (arg[i]=='\"'){
+      in_quote=!in_quote;
+      continue;
+    }
+
+    if (arg[i]==' ' && !in_quote){
+      if (lim.max_args && args.size()>=lim.max_args)
+        return parse_failed("too many arguments");
+      args.push_back(buf);
+      buf="";
+      continue;
+    }
+
+    if (arg[i]=='\\'){
+      i++;
+      if (i>=arg.length())
+        return parse_failed("unexpected occurrence of '\\' at end of string");
+    }
+
+    if (lim.max_arg_length && buf.length()>=lim.max_arg_length)
+      return parse_failed("argument is too long");
+    if (lim.max_total_length && total>=lim.max_total_length)
+      return parse_failed("arguments are too long");
+    buf+=arg[i];
+    total++;
+  }
+
+  if (in_quote)
+    return parse_failed("quote is not closed");
+
+  if (buf.length()>0){
+    if (lim.max_args && args.size()>=lim.max_args)
+      return parse_failed("too many arguments");
+    args.push_back(buf);
+  }
+
+  return parse(args);
+}
+
+CMDLINE_DECL bool parser::parse(const std::vector<std::string> &args)
+{
+  int argc=static_cast<int>(args.size());
+  std::vector<const char*> argv(argc);
+
+  for (int i=0; i<argc; i++)
+    argv[i]=args[i].c_str();
+
+  return parse(argc, argc>0?&argv[0]:NULL);
+}
+
+CMDLINE_DECL bool parser::parse(int argc, const char * const argv[])
+{
+  if (!check_limits(argc, argv))
+    return false;
+
+  if (cache_capacity==0 || argc<1)
+    return parse_args(argc, argv);
+
+  std::string key;
+  for (int i=0; i<argc; i++){
+    key+=argv[i];
+    key+='\0';
+  }
+  size_t hash=detail::hash_bytes(key);
+
+  std::map<size_t, std::list<cache_entry>::iterator>::iterator p=cache_index.find(hash);
+  if (p!=cache_index.end() && p->second->key==key){
+    hits++;
+    cache.splice(cache.begin(), cache, p->second);
+    if (prog_name=="")
+      prog_name=argv[0];
+    cache_restore(cache.front());
+    return cache.front().ok;
+  }
+
+  misses++;
+  bool ok=parse_args(argc, argv);
+  cache_store(key, hash, ok);
+  return ok;
+}
+
+CMDLINE_DECL bool parser::check_limits(int argc, const char * const argv[])
+{
+  if (!lim.max_args && !lim.max_arg_length && !lim.max_total_length)
+    return true;
+
+  const char *err=NULL;
+  if (lim.max_args && argc>0 && static_cast<size_t>(argc)>lim.max_args)
+    err="too many arguments";
+
+  // scanning stops at the first argument over a limit
+  size_t total=0;
+  for (int i=0; i<argc && !err; i++){
+    size_t n=0;
+    while (argv[i][n] &&
+           (!lim.max_arg_length || n<=lim.max_arg_length) &&
+           (!lim.max_total_length || total+n<=lim.max_total_length))
+      n++;
+    if (lim.max_arg_length && n>lim.max_arg_length)
+      err="argument is too long";
+    else if (lim.max_total_length && total+n>lim.max_total_length)
+      err="arguments are too long";
+    total+=n;
+  }
+  if (!err) return true;
+
+  errors.clear();
+  return parse_failed(err);
+}
+
+CMDLINE_DECL bool parser::parse_failed(const std::string &err)
+{
+  others.clear();
+  reset_options();
+  errors.push_back(err);
+  return false;
+}
+
+CMDLINE_DECL void parser::reset_options()
+{
+  // only options set by the previous parse have to be restored
+  for (size_t w=0; w<set_bits.words.size(); w++)
+    for (unsigned long x=set_bits.words[w]; x; x&=x-1)
+      ordered[w*detail::bitset::word_bits+detail::lowest_bit(x)]->reset();
+  set_bits.clear();
+}
+
+CMDLINE_DECL bool parser::parse_args(int argc, const char * const argv[])
+{
+  errors.clear();
+  others.clear();
+  reset_options();
+  // left over if a reader threw during the previous parse
+  discard_deferred();
+
+  if (argc<1){
+    errors.push_back("argument number must be longer than 0");
+    return false;
+  }
+  if (prog_name=="")
+    prog_name=argv[0];
+
+  if (!ambiguous.empty()){
+    errors.push_back(std::string("short option '")+ambiguous[0]+"' is ambiguous");
+    return false;
+  }
+
+  for (int i=1; i<argc; i++){
+    if (strncmp(argv[i], "--", 2)==0){
+      const char *p=strchr(argv[i]+2, '=');
+      size_t id;
+      if (p){
+        std::string name(argv[i]+2, p);
+        if (!find(name, id)){
+          errors.push_back("undefined option: --"+name);
+          continue;
+        }
+        set_option(id, p+1);
+      }
+      else{
+        std::string name(argv[i]+2);
+        if (!find(name, id)){
+          errors.push_back("undefined option: --"+name);
+          continue;
+        }
+        if (takes_value[id]){
+          if (i+1>=argc){
+            errors.push_back("option needs value: --"+name);
+            continue;
+          }
+          else{
+            i++;
+            set_option(id, argv[i]);
+          }
+        }
+        else{
+          set_option(id);
+        }
+      }
+    }
+    else if (strncmp(argv[i], "-", 1)==0){
+      const char *arg=argv[i];
+      for (int j=1; arg[j]; j++){
+        int id=short_ids[static_cast<unsigned char>(arg[j])];
+        if (id==no_option){
+          errors.push_back(std::string("undefined short option: -")+arg[j]);
+          continue;
+        }
+
+        // only the last one in a cluster takes the next argument
+        if (!arg[j+1] && i+1<argc && takes_value[id]){
+          set_option(id, argv[i+1]);
+          i++;
+        }
+        else{
+          set_option(id);
+        }
+      }
+    }
+    else{
+      others.push_back(argv[i]);
+    }
+  }
+
+  run_deferred();
+
+  if (!set_bits.contains(required_bits)){
+    for (std::map<std::string, size_t>::iterator p=index.begin();
+         p!=index.end(); p++)
+      if (required_bits.test(p->second) && !set_bits.test(p->second))
+        errors.push_back("need option: --"+p->first);
+  }
+
+  return errors.size()==0;
+}
+
+CMDLINE_DECL void parser::parse_check(const std::string &arg)
+{
+  if (!index.count("help"))
+    add("help", '?', "print this message");
+  check(0, parse(arg));
+}
+
+CMDLINE_DECL void parser::parse_check(const std::vector<std::string> &args)
+{
+  if (!index.count("help"))
+    add("help", '?', "print this message");
+  check(args.size(), parse(args));
+}
+
+CMDLINE_DECL void parser::parse_check(int argc, char *argv[])
+{
+  if (!index.count("help"))
+    add("help", '?', "print this message");
+  check(argc, parse(argc, argv));
+}
+
+CMDLINE_DECL std::string parser::error_full() const
+{
+  std::ostringstream oss;
+  for (size_t i=0; i<errors.size(); i++)
+    oss<<errors[i]<<std::endl;
+  return oss.str();
+}
+
+CMDLINE_DECL std::string parser::usage() const
+{
+  std::ostringstream oss;
+  oss<<"usage: "<<prog_name<<" ";
+  for (size_t i=0; i<ordered.size(); i++){
+    if (required_bits.test(i))
+      oss<<ordered[i]->short_description(names[i])<<" ";
+  }
+  
+  oss<<"[options] ... "<<ftr<<std::endl;
+  oss<<"options:"<<std::endl;
+
+  size_t max_width=0;
+  for (size_t i=0; i<ordered.size(); i++){
+    max_width=std::max(max_width, names[i].length());
+  }
+  for (size_t i=0; i<ordered.size(); i++){
+    if (short_names[i]){
+      oss<<"  -"<<short_names[i]<<", ";
+    }
+    else{
+      oss<<"      ";
+    }
+
+    oss<<"--"<<names[i];
+    for (size_t j=names[i].length(); j<max_width+4; j++)
+      oss<<' ';
+    oss<<descriptions[i]<<std::endl;
+  }
+  return oss.str();
+}
+
+CMDLINE_DECL std::string parser::completion(const std::string &shell) const
+{
+  std::string prog=prog_name.substr(prog_name.rfind('/')+1);
+  if (prog=="") CMDLINE_THROW(cmdline_error("program name is not set"));
+
+  std::ostringstream oss;
+
+  if (shell=="bash"){
+    std::string fn="_";
+    for (size_t i=0; i<prog.length(); i++)
+      fn+=isalnum(static_cast<unsigned char>(prog[i]))?prog[i]:'_';
+    fn+="_complete";
+
+    std::string words, values, alts;
+    for (size_t i=0; i<ordered.size(); i++){
+      if (names[i]=="") continue;
+      // words are quoted, because compgen -W would expand globs like -?
+      std::string pat=detail::shell_quote("--"+names[i]);
+      words+=" "+pat;
+      if (short_names[i]){
+        std::string sn=detail::shell_quote(std::string("-")+short_names[i]);
+        pat+="|"+sn;
+        words+=" "+sn;
+      }
+      if (!takes_value[i]) continue;
+
+      std::vector<std::string> alt=ordered[i]->alternatives();
+      if (alt.empty()){
+        values+=values==""?pat:"|"+pat;
+        continue;
+      }
+      std::string list;
+      for (size_t j=0; j<alt.size(); j++)
+        list+=" "+detail::shell_quote(alt[j]);
+      alts+="    "+pat+")\n"
+        "      for w in"+list+"; do [[ \"$w\" == \"$cur\"* ]] && COMPREPLY+=(\"$w\"); done\n"
+        "      return;;\n";
+    }
+
+    oss<<"# bash completion for "<<prog<<std::endl
+       <<fn<<"()"<<std::endl
+       <<"{"<<std::endl
+       <<"  local cur=\"${COMP_WORDS[COMP_CWORD]}\" prev=\"${COMP_WORDS[COMP_CWORD-1]}\" w"<<std::endl
+       <<"  COMPREPLY=()"<<std::endl
+       <<"  # --name=value is split at '='"<<std::endl
+       <<"  if [[ \"$cur\" == \"=\" ]]; then cur=\"\"; elif [[ \"$prev\" == \"=\" ]]; then prev=\"${COMP_WORDS[COMP_CWORD-2]}\"; fi"<<std::endl
+       <<"  case \"$prev\" in"<<std::endl
+       <<alts;
+    if (values!="")
+      oss<<"    "<<values<<")"<<std::endl
+         <<"      COMPREPLY=($(compgen -f -- \"$cur\"))"<<std::endl
+         <<"      return;;"<<std::endl;
+    oss<<"  esac"<<std::endl
+       <<"  if [[ \"$cur\" == -* ]]; then"<<std::endl
+       <<"    for w in"<<words<<"; do [[ \"$w\" == \"$cur\"* ]] && COMPREPLY+=(\"$w\"); done"<<std::endl
+       <<"  else"<<std::endl
+       <<"    COMPREPLY=($(compgen -f -- \"$cur\"))"<<std::endl
+       <<"  fi"<<std::endl
+       <<"}"<<std::endl
+       <<"complete -F "<<fn<<" "<<prog<<std::endl;
+  }
+  else if (shell=="zsh"){
+    oss<<"#compdef "<<prog<<std::endl
+       <<"_arguments -s \\"<<std::endl;
+    for (size_t i=0; i<ordered.size(); i++){
+      if (names[i]=="") continue;
+      std::string desc="["+detail::zsh_escape(descriptions[i])+"]";
+      std::string arg;
+      if (takes_value[i]){
+        std::vector<std::string> alt=ordered[i]->alternatives();
+        std::string action="_default";
+        if (!alt.empty()){
+          action="(";
+          for (size_t j=0; j<alt.size(); j++)
+            action+=(j?" ":"")+detail::shell_escape(alt[j]);
+          action+=")";
+        }
+        arg=":"+detail::zsh_escape(names[i])+":"+action;
+      }
+
+      // -p+ and --port= accept the value both attached and separated
+      std::string ln=detail::shell_quote("--"+names[i]+(takes_value[i]?"=":""));
+      oss<<"  ";
+      if (short_names[i]){
+        std::string sn=std::string(1, short_names[i]);
+        oss<<detail::shell_quote("(-"+sn+" --"+names[i]+")")
+           <<"{-"<<detail::shell_escape(sn)<<(takes_value[i]?"+":"")<<","<<ln<<"}";
+      }
+      else{
+        oss<<ln;
+      }
+      oss<<detail::shell_quote(desc+arg)<<" \\"<<std::endl;
+    }
+    oss<<"  '*:file:_files'"<<std::endl;
+  }
+  else if (shell=="fish"){
+    oss<<"# fish completion for "<<prog<<std::endl;
+    for (size_t i=0; i<ordered.size(); i++){
+      if (names[i]=="") continue;
+      oss<<"complete -c "<<detail::fish_quote(prog);
+      if (short_names[i])
+        oss<<" -s "<<detail::fish_quote(std::string(1, short_names[i]));
+      oss<<" -l "<<detail::fish_quote(names[i]);
+      if (takes_value[i]){
+        std::vector<std::string> alt=ordered[i]->alternatives();
+        if (alt.empty())
+          oss<<" -r";
+        else{
+          std::string list;
+          for (size_t j=0; j<alt.size(); j++)
+            list+=(j?" ":"")+alt[j];
+          oss<<" -x -a "<<detail::fish_quote(list);
+        }
+      }
+      oss<<" -d "<<detail::fish_quote(descriptions[i])<<std::endl;
+    }
+  }
+  else{
+    CMDLINE_THROW(cmdline_error("unknown shell: "+shell));
+  }
+
+  return oss.str();
+}
+
+CMDLINE_DECL void parser::check(int argc, bool ok)
+{
+  if ((argc==1 && !ok) || exist("help")){
+    std::cerr<<usage();
+    exit(0);
+  }
+
+  if (!ok){
+    std::cerr<<error()<<std::endl<<usage();
+    exit(1);
+  }
+}
+
+CMDLINE_DECL void parser::enable_cache(size_t capacity)
+{
+  cache_capacity=capacity;
+  while (cache.size()>cache_capacity)
+    cache_evict(--cache.end());
+}
+
+CMDLINE_DECL void parser::cache_store(const std::string &key, size_t hash, bool ok)
+{
+  // entries are never copied after they are filled
+  cache.push_front(cache_entry());
+  cache_entry &e=cache.front();
+  e.key=key;
+  e.hash=hash;
+  e.ok=ok;
+  e.set_bits=set_bits;
+  for (size_t w=0; w<set_bits.words.size(); w++){
+    for (unsigned long x=set_bits.words[w]; x; x&=x-1){
+      size_t id=w*detail::bitset::word_bits+detail::lowest_bit(x);
+      if (takes_value[id])
+        e.values.push_back(std::make_pair(id, ordered[id]->save()));
+    }
+  }
+  e.others=others;
+  e.errors=errors;
+
+  // on a hash collision, the older entry is dropped
+  std::map<size_t, std::list<cache_entry>::iterator>::iterator p=cache_index.find(hash);
+  if (p!=cache_index.end())
+    cache_evict(p->second);
+  cache_index[hash]=cache.begin();
+
+  while (cache.size()>cache_capacity)
+    cache_evict(--cache.end());
+}
+
+CMDLINE_DECL void parser::cache_restore(const cache_entry &e)
+{
+  reset_options();
+  set_bits=e.set_bits;
+  for (size_t i=0; i<e.values.size(); i++)
+    ordered[e.values[i].first]->restore(e.values[i].second);
+  others=e.others;
+  errors=e.errors;
+}
+
+CMDLINE_DECL void parser::cache_evict(std::list<cache_entry>::iterator p)
+{
+  std::map<size_t, std::list<cache_entry>::iterator>::iterator q=cache_index.find(p->hash);
+  if (q!=cache_index.end() && q->second==p)
+    cache_index.erase(q);
+  cache.erase(p);
+}
+
+CMDLINE_DECL void parser::clear_cache()
+{
+  cache.clear();
+  cache_index.clear();
+}
+
+CMDLINE_DECL void parser::run_deferred()
+{
+  if (deferred.empty()) return;
+
+#if __cplusplus>=201103L
+  std::atomic<size_t> next(0);
+#ifndef CMDLINE_NO_EXCEPTIONS
+  // exceptions of readers are rethrown here, the first one in argv order
+  std::vector<std::exception_ptr> thrown(deferred.size());
+  auto work=[this, &next, &thrown]{
+    for (size_t i; (i=next++)<deferred.size(); ){
+      try{
+        deferred[i].result=ordered[deferred[i].id]->convert(deferred[i].value);
+      }
+      catch(...){
+        thrown[i]=std::current_exception();
+      }
+    }
+  };
+#else
+  auto work=[this, &next]{
+    for (size_t i; (i=next++)<deferred.size(); )
+      deferred[i].result=ordered[deferred[i].id]->convert(deferred[i].value);
+  };
+#endif
+  std::vector<std::thread> th;
+#ifndef CMDLINE_NO_EXCEPTIONS
+  try{
+#endif
+    th.reserve(std::min(concurrency, deferred.size()));
+    for (size_t i=1; i<std::min(concurrency, deferred.size()); i++)
+      th.push_back(std::thread(work));
+#ifndef CMDLINE_NO_EXCEPTIONS
+  }
+  catch(...){
+    // the rest is read by the threads already started
+  }
+#endif
+  work();
+  for (size_t i=0; i<th.size(); i++)
+    th[i].join();
+#ifndef CMDLINE_NO_EXCEPTIONS
+  for (size_t i=0; i<thrown.size(); i++){
+    if (thrown[i]){
+      discard_deferred();
+      std::rethrow_exception(thrown[i]);
+    }
+  }
+#endif
+#else
+#ifndef CMDLINE_NO_EXCEPTIONS
+  try{
+#endif
+    for (size_t i=0; i<deferred.size(); i++)
+      deferred[i].result=ordered[deferred[i].id]->convert(deferred[i].value);
+#ifndef CMDLINE_NO_EXCEPTIONS
+  }
+  catch(...){
+    discard_deferred();
+    throw;
+  }
+#endif
+#endif
+
+  // apply in argv order, and put errors where the serial parse puts them
+  std::vector<std::string> merged;
+  size_t e=0;
+  for (size_t i=0; i<deferred.size(); i++){
+    deferred_read &r=deferred[i];
+    if (r.result){
+      ordered[r.id]->restore(r.result);
+      delete r.result;
+      set_bits.set(r.id);
+      continue;
+    }
+    for (; e<r.error_pos; e++)
+      merged.push_back(errors[e]);
+    merged.push_back("option value is invalid: --"+names[r.id]+"="+r.value);
+  }
+  if (!merged.empty()){
+    for (; e<errors.size(); e++)
+      merged.push_back(errors[e]);
+    errors.swap(merged);
+  }
+  deferred.clear();
+}
+
+CMDLINE_DECL void parser::discard_deferred()
+{
+  for (size_t i=0; i<deferred.size(); i++)
+    delete deferred[i].result;
+  deferred.clear();
+}
+
+CMDLINE_DECL void parser::register_option(const std::string &name, char short_name, bool need,
+                                          const std::string &desc, option_base *opt)
+{
+  clear_cache();
+
+  size_t id=ordered.size();
+  index[name]=id;
+  ordered.push_back(opt);
+  names.push_back(name);
+  short_names.push_back(short_name);
+  descriptions.push_back(desc);
+  takes_value.push_back(opt->has_value());
+  concurrent.push_back(opt->concurrent());
+  set_bits.resize(id+1);
+  required_bits.resize(id+1);
+  if (need)
+    required_bits.set(id);
+
+  if (short_name && name.length()>0){
+    int &s=short_ids[static_cast<unsigned char>(short_name)];
+    if (s==no_option)
+      s=static_cast<int>(id);
+    else if (s!=ambiguous_option){
+      s=ambiguous_option;
+      ambiguous+=short_name;
+    }
+  }
+}
+
+CMDLINE_DECL void parser::set_option(size_t id)
+{
+  if (!ordered[id]->set()){
+    errors.push_back("option needs value: --"+names[id]);
+    return;
+  }
+  set_bits.set(id);
+}
+
+CMDLINE_DECL void parser::set_option(size_t id, const std::string &value)
+{
+  if (concurrency>1 && concurrent[id]){
+    deferred_read r;
+    r.id=id;
+    r.value=value;
+    r.error_pos=errors.size();
+    r.result=NULL;
+    deferred.push_back(r);
+    return;
+  }
+  if (!ordered[id]->set(value)){
+    errors.push_back("option value is invalid: --"+names[id]+"="+value);
+    return;
+  }
+  set_bits.set(id);
+}
+
+#endif
+
 } // cmdline
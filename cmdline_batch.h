@@ -0,0 +1,250 @@
+/*
+  Copyright (c) 2009, Hideyuki Tanaka
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+  * Redistributions of source code must retain the above copyright
+  notice, this list of conditions and the following disclaimer.
+  * Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+  * Neither the name of the <organization> nor the
+  names of its contributors may be used to endorse or promote products
+  derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY <copyright holder> ''AS IS'' AND ANY
+  EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL <copyright holder> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+// Validates many command lines against one schema (requires C++11).
+//
+//   cmdline::batch b(define_schema, fields, cmdline::batch_jsonl, 4);
+//   b.run(stdin, stdout);
+//
+// Each input line is a command line including the program name,
+// in the syntax of parser::parse(const std::string &).
+// One result line is written for each non-empty input line,
+// in the same order as the input.
+
+#include "cmdline.h"
+
+#include <cstdio>
+#include <functional>
+#include <thread>
+
+namespace cmdline{
+
+enum batch_format{
+  batch_jsonl,
+  batch_tsv
+};
+
+class batch{
+public:
+  struct stats{
+    stats(): lines(0), ok(0), failed(0) {}
+    size_t lines;
+    size_t ok;
+    size_t failed;
+  };
+
+  // schema is called once for each worker to define the options.
+  // fields are the names of options whose values are written for valid lines.
+  batch(const std::function<void(parser &)> &schema,
+        const std::vector<std::string> &fields,
+        batch_format format=batch_jsonl,
+        size_t threads=1,
+        size_t block_size=1<<22)
+    : fields(fields), format(format), block_size(block_size)
+    , workers(threads>0?threads:1){
+    for (size_t i=0; i<workers.size(); i++){
+      schema(workers[i].p);
+      // reject unknown field names before reading any input
+      for (size_t j=0; j<fields.size(); j++)
+        workers[i].p.value_string(fields[j]);
+    }
+  }
+
+  // cmdline_error is thrown if in cannot be read or out cannot be written;
+  // results of the lines read before the error have been written.
+  stats run(std::FILE *in, std::FILE *out){
+    stats st;
+    std::vector<char> buf(block_size);
+    std::string carry;
+    size_t lineno=0;
+
+    for (;;){
+      size_t n=std::fread(&buf[0], 1, buf.size(), in);
+      bool eof=n<buf.size();
+      if (eof && std::ferror(in)){
+        std::fflush(out);
+        CMDLINE_THROW(cmdline_error("cannot read input"));
+      }
+
+      // lines of this block; the last partial line is kept in carry
+      std::vector<std::string> lines;
+      size_t b=0;
+      for (size_t i=0; i<n; i++){
+        if (buf[i]!='\n') continue;
+        if (carry.empty())
+          lines.push_back(std::string(&buf[b], &buf[i]));
+        else{
+          carry.append(&buf[b], &buf[i]);
+          lines.push_back(carry);
+          carry.clear();
+        }
+        b=i+1;
+      }
+      carry.append(&buf[0]+b, &buf[0]+n);
+      if (eof && !carry.empty()){
+        lines.push_back(carry);
+        carry.clear();
+      }
+
+      process(lines, lineno, st);
+      lineno+=lines.size();
+
+      for (size_t i=0; i<workers.size(); i++){
+        std::fwrite(workers[i].out.data(), 1, workers[i].out.size(), out);
+        workers[i].out.clear();
+      }
+
+      if (eof) break;
+    }
+    if (std::fflush(out)!=0 || std::ferror(out))
+      CMDLINE_THROW(cmdline_error("cannot write output"));
+    return st;
+  }
+
+private:
+  struct worker{
+    worker(): ok(0), failed(0) {}
+    parser p;
+    std::string out;
+    size_t ok, failed;
+  };
+
+  void process(const std::vector<std::string> &lines, size_t lineno, stats &st){
+    size_t nw=std::min(workers.size(), lines.size());
+    if (nw==0) return;
+
+    // contiguous ranges keep the output in input order
+    size_t chunk=(lines.size()+nw-1)/nw;
+    std::vector<std::thread> ths;
+    for (size_t i=1; i<nw; i++)
+      ths.push_back(std::thread(&batch::process_range, this, std::ref(workers[i]),
+                                std::cref(lines), i*chunk,
+                                std::min(lines.size(), (i+1)*chunk), lineno));
+    process_range(workers[0], lines, 0, std::min(lines.size(), chunk), lineno);
+    for (size_t i=0; i<ths.size(); i++)
+      ths[i].join();
+
+    for (size_t i=0; i<nw; i++){
+      st.ok+=workers[i].ok;
+      st.failed+=workers[i].failed;
+      workers[i].ok=workers[i].failed=0;
+    }
+    st.lines=st.ok+st.failed;
+  }
+
+  void process_range(worker &w, const std::vector<std::string> &lines,
+                     size_t begin, size_t end, size_t lineno){
+    for (size_t i=begin; i<end; i++){
+      std::string line=lines[i];
+      if (!line.empty() && line[line.length()-1]=='\r')
+        line.erase(line.length()-1);
+      if (line.empty()) continue;
+
+      bool ok=w.p.parse(line);
+      if (ok) w.ok++;
+      else w.failed++;
+      write_result(w, lineno+i+1, ok);
+    }
+  }
+
+  void write_result(worker &w, size_t lineno, bool ok){
+    std::string &o=w.out;
+    std::ostringstream num;
+    num<<lineno;
+
+    if (format==batch_jsonl){
+      o+="{\"line\":"+num.str()+",\"ok\":"+(ok?"true":"false");
+      if (ok){
+        for (size_t i=0; i<fields.size(); i++){
+          o+=",";
+          json_string(o, fields[i]);
+          o+=":";
+          json_string(o, w.p.value_string(fields[i]));
+        }
+      }
+      else{
+        o+=",\"error\":";
+        json_string(o, w.p.error());
+      }
+      o+="}\n";
+    }
+    else{
+      o+=num.str()+(ok?"\tok":"\terror");
+      if (ok){
+        for (size_t i=0; i<fields.size(); i++){
+          o+="\t";
+          tsv_string(o, w.p.value_string(fields[i]));
+        }
+      }
+      else{
+        o+="\t";
+        tsv_string(o, w.p.error());
+      }
+      o+="\n";
+    }
+  }
+
+  static void json_string(std::string &o, const std::string &s){
+    static const char hex[]="0123456789abcdef";
+    o+='"';
+    for (size_t i=0; i<s.length(); i++){
+      unsigned char c=s[i];
+      if (c=='"' || c=='\\'){
+        o+='\\';
+        o+=c;
+      }
+      else if (c<0x20){
+        o+="\\u00";
+        o+=hex[c>>4];
+        o+=hex[c&15];
+      }
+      else o+=c;
+    }
+    o+='"';
+  }
+
+  static void tsv_string(std::string &o, const std::string &s){
+    for (size_t i=0; i<s.length(); i++){
+      switch (s[i]){
+      case '\\': o+="\\\\"; break;
+      case '\t': o+="\\t"; break;
+      case '\n': o+="\\n"; break;
+      case '\r': o+="\\r"; break;
+      default: o+=s[i];
+      }
+    }
+  }
+
+  std::vector<std::string> fields;
+  batch_format format;
+  size_t block_size;
+  std::vector<worker> workers;
+};
+
+} // cmdline
@@ -0,0 +1,316 @@
+/*
+  Copyright (c) 2009, Hideyuki Tanaka
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+  * Redistributions of source code must retain the above copyright
+  notice, this list of conditions and the following disclaimer.
+  * Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+  * Neither the name of the <organization> nor the
+  names of its contributors may be used to endorse or promote products
+  derived from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY <copyright holder> ''AS IS'' AND ANY
+  EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL <copyright holder> BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+// Hot-reloadable configuration (requires C++11 and Linux inotify).
+//
+//   void schema(cmdline::parser &a){ ... }
+//   cmdline::config_watcher cfg("app.conf", schema);
+//   cfg.start();
+//   ...
+//   cmdline::config_watcher::reader r=cfg.read();
+//   int port=r->get<int>("port");
+//
+// Each non-empty line of the file which does not start with '#' is one
+// argument, e.g. "--port=8080" or "--gzip".
+// A reload parses the file into a new parser, which is never modified
+// after it is published. Readers get the current one lock-free (a read
+// retries if a reload is published at the same moment, but never waits
+// for a reload to finish). Each parser is reference counted and deleted
+// by whoever releases it last, so a reader guard may be held for any time,
+// also while calling reload().
+// When parsing fails, the current configuration is kept.
+
+#include "cmdline.h"
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace cmdline{
+
+struct reload_event{
+  bool ok;
+  std::string error;
+  std::chrono::nanoseconds latency;
+  size_t generation;
+};
+
+class config_watcher{
+public:
+  typedef std::function<void(parser &)> schema_fn;
+  typedef std::function<void(const reload_event &)> report_fn;
+
+private:
+  // a published parser and the number of its holders,
+  // counting the watcher while it is current
+  struct snapshot{
+    snapshot(): refs(1) {}
+    parser p;
+    std::atomic<size_t> refs;
+  };
+
+  static void release(snapshot *s){
+    if (s && s->refs.fetch_sub(1)==1) delete s;
+  }
+
+public:
+  class reader{
+  public:
+    reader(reader &&r): s(r.s) {
+      r.s=nullptr;
+    }
+    ~reader(){
+      release(s);
+    }
+
+    const parser &operator*() const { return s->p; }
+    const parser *operator->() const { return &s->p; }
+
+  private:
+    friend class config_watcher;
+    explicit reader(snapshot *s): s(s) {}
+    reader(const reader &)=delete;
+    reader &operator=(const reader &)=delete;
+
+    snapshot *s;
+  };
+
+  // The file is parsed once here; cmdline_error is thrown if it fails.
+  config_watcher(const std::string &path,
+                 const schema_fn &schema,
+                 const report_fn &report=report_fn())
+    : path(path), schema(schema), report(report)
+    , current(nullptr), epoch(0), generation(0), failures(0){
+    active[0]=0;
+    active[1]=0;
+    stop_pipe[0]=stop_pipe[1]=-1;
+    std::string err;
+    if (!reload(&err)) CMDLINE_THROW(cmdline_error(err));
+  }
+
+  ~config_watcher(){
+    stop();
+    release(current.load());
+  }
+
+  // Parses the file now and publishes the result if it is valid.
+  bool reload(){
+    return reload(nullptr);
+  }
+
+  // Starts a thread which reloads the file whenever it is written or replaced.
+  // cmdline_error is thrown if the file cannot be watched.
+  void start(){
+    if (th.joinable()) return;
+
+    std::string::size_type slash=path.rfind('/');
+    std::string dir=slash==std::string::npos?".":path.substr(0, slash+1);
+
+    int fd=inotify_init1(IN_CLOEXEC);
+    if (fd<0) CMDLINE_THROW(cmdline_error(std::string("cannot watch: ")+std::strerror(errno)));
+    // watch the directory to catch editors which replace the file by rename
+    if (inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE|IN_MOVED_TO)<0){
+      std::string err=std::strerror(errno);
+      close(fd);
+      CMDLINE_THROW(cmdline_error("cannot watch: "+dir+": "+err));
+    }
+    if (pipe(stop_pipe)!=0){
+      close(fd);
+      CMDLINE_THROW(cmdline_error("cannot create pipe"));
+    }
+    th=std::thread(&config_watcher::watch, this, fd);
+  }
+
+  void stop(){
+    if (!th.joinable()) return;
+    char c=0;
+    if (write(stop_pipe[1], &c, 1)!=1) {}
+    th.join();
+    close(stop_pipe[0]);
+    close(stop_pipe[1]);
+    stop_pipe[0]=stop_pipe[1]=-1;
+  }
+
+  // Lock-free, not wait-free: retries while a reload switches epochs,
+  // but never waits for a reload to finish.
+  // The epoch only guards taking the reference, not the returned reader.
+  reader read() const {
+    for (;;){
+      unsigned e=epoch.load();
+      active[e&1].fetch_add(1);
+      if (epoch.load()==e){
+        snapshot *s=current.load();
+        s->refs.fetch_add(1);
+        active[e&1].fetch_sub(1);
+        return reader(s);
+      }
+      active[e&1].fetch_sub(1);
+    }
+  }
+
+  // Configurations published so far, including the initial load.
+  size_t reloads() const { return generation.load(); }
+  // Reloads which kept the previous configuration, and watch errors.
+  size_t failed_reloads() const { return failures.load(); }
+
+private:
+  config_watcher(const config_watcher &)=delete;
+  config_watcher &operator=(const config_watcher &)=delete;
+
+  bool reload(std::string *err){
+    std::lock_guard<std::mutex> lock(reload_mutex);
+    std::chrono::steady_clock::time_point start=std::chrono::steady_clock::now();
+
+    reload_event ev;
+    snapshot *next=new snapshot();
+    schema(next->p);
+    ev.ok=load(next->p, ev.error);
+
+    if (ev.ok){
+      publish(next);
+      generation++;
+    }
+    else{
+      delete next;
+      failures++;
+    }
+
+    ev.latency=std::chrono::steady_clock::now()-start;
+    ev.generation=generation.load();
+    if (report) report(ev);
+    if (err) *err=ev.error;
+    return ev.ok;
+  }
+
+  bool load(parser &p, std::string &error) const {
+    std::ifstream ifs(path.c_str());
+    if (!ifs){
+      error="cannot open: "+path;
+      return false;
+    }
+
+    std::vector<std::string> args(1, path);
+    std::string line;
+    while (std::getline(ifs, line)){
+      std::string::size_type b=line.find_first_not_of(" \t\r");
+      if (b==std::string::npos || line[b]=='#') continue;
+      std::string::size_type e=line.find_last_not_of(" \t\r");
+      args.push_back(line.substr(b, e-b+1));
+    }
+
+    if (!p.parse(args)){
+      error=p.error();
+      return false;
+    }
+    return true;
+  }
+
+  void publish(snapshot *next){
+    snapshot *old=current.exchange(next);
+    if (!old) return;
+
+    // readers which may be taking a reference to old registered with the
+    // previous epoch; they leave it right after, so this wait is short
+    unsigned e=epoch.load();
+    epoch.store(e+1);
+    while (active[e&1].load()!=0)
+      std::this_thread::yield();
+    release(old);
+  }
+
+  // Reports an error which stops the watch thread.
+  void watch_failed(const char *what){
+    std::lock_guard<std::mutex> lock(reload_mutex);
+    reload_event ev;
+    ev.ok=false;
+    ev.error=std::string("watch failed: ")+what+": "+std::strerror(errno);
+    ev.latency=std::chrono::nanoseconds(0);
+    ev.generation=generation.load();
+    failures++;
+    if (report) report(ev);
+  }
+
+  void watch(int fd){
+    std::string::size_type slash=path.rfind('/');
+    std::string base=slash==std::string::npos?path:path.substr(slash+1);
+
+    alignas(inotify_event) char buf[4096];
+    for (;;){
+      pollfd fds[2]={{fd, POLLIN, 0}, {stop_pipe[0], POLLIN, 0}};
+      if (poll(fds, 2, -1)<0){
+        if (errno==EINTR) continue;
+        watch_failed("poll");
+        break;
+      }
+      if (fds[1].revents) break;
+      if (!fds[0].revents) continue;
+
+      ssize_t n=::read(fd, buf, sizeof(buf));
+      if (n<0){
+        if (errno==EINTR || errno==EAGAIN) continue;
+        watch_failed("read");
+        break;
+      }
+      bool changed=false;
+      for (ssize_t i=0; i<n; ){
+        const inotify_event *ev=reinterpret_cast<const inotify_event*>(buf+i);
+        if (ev->len>0 && base==ev->name) changed=true;
+        i+=sizeof(inotify_event)+ev->len;
+      }
+      if (changed) reload();
+    }
+    close(fd);
+  }
+
+  std::string path;
+  schema_fn schema;
+  report_fn report;
+
+  std::atomic<snapshot*> current;
+  std::atomic<unsigned> epoch;
+  mutable std::atomic<size_t> active[2];
+
+  std::atomic<size_t> generation;
+  std::atomic<size_t> failures;
+
+  std::mutex reload_mutex;
+  std::thread th;
+  int stop_pipe[2];
+};
+
+} // cmdline